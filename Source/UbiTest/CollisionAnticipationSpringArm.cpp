@@ -1,11 +1,29 @@
 #include "UbiTest/CollisionAnticipationSpringArm.h"
 #include "GameFramework/Pawn.h"
 #include "Engine/HitResult.h"
+#include "Engine/OverlapResult.h"
+#include "Components/PrimitiveComponent.h"
 #include "Engine/World.h"
 #include "DrawDebugHelpers.h"
 #include "Math/RotationMatrix.h"
 #include "PhysicsEngine/PhysicsSettings.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "UObject/UObjectIterator.h"
+#include <utility>
 
+DEFINE_LOG_CATEGORY_STATIC(LogCameraArm, Log, All);
+
+#if !UE_BUILD_SHIPPING
+static FAutoConsoleCommandWithWorldAndArgs GCameraArmBenchmarkSolverCommand(
+	TEXT("CameraArm.BenchmarkSolver"),
+	TEXT("Times the generic and the specialized solver of every camera arm in the world. Usage: CameraArm.BenchmarkSolver [Iterations]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic([](const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 Iterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+		UCollisionAnticipationSpringArm::RunSolverBenchmark(World, Iterations);
+	}));
+#endif
 
 const FName UCollisionAnticipationSpringArm::SocketName(TEXT("SpringEndpoint"));
 
@@ -19,6 +37,10 @@ UCollisionAnticipationSpringArm::UCollisionAnticipationSpringArm()
 	bTickInEditor = true;
 	bUsePawnControlRotation = false;
 	bDoCollisionTest = true;
+	bDisableWhenNotViewable = true;
+	bFilterCameraBlockers = false;
+	bSkipSolverWhenIdle = true;
+	bPredictStaticOnly = false;
 
 	bInheritPitch = true;
 	bInheritYaw = true;
@@ -26,10 +48,6 @@ UCollisionAnticipationSpringArm::UCollisionAnticipationSpringArm()
 
 	TargetArmLength = 300.0f;
 	TraceChannel = ECC_Camera;
-
-	RelativeSocketRotation = FQuat::Identity;
-
-	ReturnTimer = 0;
 }
 
 void UCollisionAnticipationSpringArm::BeginPlay()
@@ -37,19 +55,34 @@ void UCollisionAnticipationSpringArm::BeginPlay()
 	Super::BeginPlay();
 
 	//AttachedCamera = Cast<UCameraComponent>(GetChildComponent(0));
+
+	//the net role of replicated actors is only reliable from here
+	RefreshViewableState();
 }
 
 void UCollisionAnticipationSpringArm::OnRegister()
 {
 	Super::OnRegister();
 
+	RefreshViewableState();
+
 	// Set initial location.
-	UpdateDesiredArmLocation(false, false, 0.f);
+	if (bCameraViewable)
+	{
+		UpdateDesiredArmLocation(false, false, 0.f);
+	}
 }
 
 void UCollisionAnticipationSpringArm::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	//the tick should already be disabled, but don't trace anything if something turned it back on
+	if (!bCameraViewable)
+	{
+		return;
+	}
+
 	UpdateDesiredArmLocation(bDoCollisionTest, bDoCollisionPrediction, DeltaTime);
 
 #if WITH_EDITOR
@@ -105,31 +138,321 @@ FRotator UCollisionAnticipationSpringArm::GetTargetRotation() const
 	return DesiredRot;
 }
 
+namespace
+{
+	//rotation of an additional view, its offset is applied in the space of the arm target rotation
+	FRotator ComposeViewRotation(const FRotator& TargetRotation, const FRotator& RotationOffset)
+	{
+		return (TargetRotation.Quaternion() * RotationOffset.Quaternion()).Rotator();
+	}
+
+	//how close (in unreal units) the camera has to be from where the prediction wants it before the solver can stop running
+	constexpr float SettledForwardMovementTolerance = 0.1f;
+
+	//true if the code of this feature exists in the kernel: always in the generic kernel, only for their own features in the specialized ones
+	//used with if constexpr so the code of the other features is never compiled into a specialized kernel, whatever the optimization level
+	template<uint32 Features, uint32 Feature>
+	constexpr bool SolverFeatureCompiledIn = (Features & (Feature | UCollisionAnticipationSpringArm::SF_Generic)) != 0;
+
+	//true if a compiled-in feature is enabled: read from the runtime mask by the generic kernel, always true for the specialized ones
+	template<uint32 Features, uint32 Feature>
+	FORCEINLINE constexpr bool HasSolverFeature(uint32 RuntimeFeatures)
+	{
+		if constexpr ((Features & UCollisionAnticipationSpringArm::SF_Generic) != 0)
+		{
+			return (RuntimeFeatures & Feature) != 0;
+		}
+		else
+		{
+			return (Features & Feature) != 0;
+		}
+	}
+}
+
 void UCollisionAnticipationSpringArm::UpdateDesiredArmLocation(bool bDoCollision, bool bPredictCollisions, float DeltaTime)
 {
-	// If our viewtarget is simulating using physics, we may need to clamp deltatime
+	//only pick a new kernel when the settings changed, the kernel itself never looks at them again
+	if (bSolverFeaturesDirty)
+	{
+		SettingsSolverFeatures = ComputeSettingsSolverFeatures();
+		bSolverFeaturesDirty = false;
+	}
+	const uint32 Features = SettingsSolverFeatures | (bDoCollision ? SF_Collide : 0) | (bPredictCollisions ? SF_Predict : 0);
+	if (Features != ActiveSolverFeatures || !ActiveSolver)
+	{
+		ActiveSolverFeatures = Features;
+		ActiveSolver = GetSolverKernel(Features);
+		bSolverSettled = false;
+	}
+
+	//if nothing moved since the camera settled, the cached socket transform is still right, only check for moving obstacles once in a while
+	const FSolverInputs Inputs = GatherSolverInputs();
+	if (bSkipSolverWhenIdle && bSolverSettled && Inputs.Equals(LastSolverInputs))
+	{
+		if (IdleRevalidationTimer + DeltaTime < IdleRevalidationInterval)
+		{
+			IdleRevalidationTimer += DeltaTime;
+			return;
+		}
+	}
+
+	IdleRevalidationTimer = 0;
+	LastSolverInputs = Inputs;
+
+	(this->*ActiveSolver)(DeltaTime, Features);
+}
+
+UCollisionAnticipationSpringArm::FSolverInputs UCollisionAnticipationSpringArm::GatherSolverInputs() const
+{
+	FSolverInputs Inputs;
+	Inputs.ComponentTransform = GetComponentTransform();
+	Inputs.TargetRotation = GetTargetRotation();
+	Inputs.SocketOffset = SocketOffset;
+	Inputs.ArmLength = TargetArmLength;
+	Inputs.bIsOffset = bIsOffset;
+	Inputs.SphereTraceSize = SphereTraceSize;
+	Inputs.TraceChannel = TraceChannel;
+	for (int32 ViewIndex = 0; ViewIndex < AdditionalViews.Num(); ++ViewIndex)
+	{
+		if (!IsValidView(ViewIndex))
+		{
+			continue;
+		}
+
+		const FCameraArmView& View = AdditionalViews[ViewIndex];
+		Inputs.AdditionalViewsHash = HashCombine(Inputs.AdditionalViewsHash, GetTypeHash(View.SocketName));
+		Inputs.AdditionalViewsHash = HashCombine(Inputs.AdditionalViewsHash, GetTypeHash(View.ArmLength));
+		Inputs.AdditionalViewsHash = HashCombine(Inputs.AdditionalViewsHash, GetTypeHash(View.SocketOffset));
+		Inputs.AdditionalViewsHash = HashCombine(Inputs.AdditionalViewsHash, GetTypeHash(View.RotationOffset.Pitch));
+		Inputs.AdditionalViewsHash = HashCombine(Inputs.AdditionalViewsHash, GetTypeHash(View.RotationOffset.Yaw));
+		Inputs.AdditionalViewsHash = HashCombine(Inputs.AdditionalViewsHash, GetTypeHash(View.RotationOffset.Roll));
+	}
+	return Inputs;
+}
+
+bool UCollisionAnticipationSpringArm::FSolverInputs::Equals(const FSolverInputs& Other) const
+{
+	return ComponentTransform.Equals(Other.ComponentTransform)
+		&& TargetRotation.Equals(Other.TargetRotation)
+		&& SocketOffset.Equals(Other.SocketOffset)
+		&& ArmLength == Other.ArmLength
+		&& SphereTraceSize == Other.SphereTraceSize
+		&& TraceChannel == Other.TraceChannel
+		&& AdditionalViewsHash == Other.AdditionalViewsHash
+		&& bIsOffset == Other.bIsOffset;
+}
+
+uint32 UCollisionAnticipationSpringArm::ComputeSettingsSolverFeatures() const
+{
+	uint32 Features = 0;
 	if (bClampToMaxPhysicsDeltaTime)
 	{
-		// Use the same max timestep cap as the physics system to avoid camera jitter when the viewtarget simulates less time than the camera
-		DeltaTime = FMath::Min(DeltaTime, UPhysicsSettings::Get()->MaxPhysicsDeltaTime);
+		Features |= SF_ClampDeltaTime;
+	}
+	if (bUseSpeedCurve && IsValid(SpeedCurve))
+	{
+		Features |= SF_SpeedCurve;
+	}
+	if (bUsePositionCurve && IsValid(PositionCurve))
+	{
+		Features |= SF_PositionCurve;
+	}
+#if ENABLE_DRAW_DEBUG
+	if (bShowDebugInfo)
+	{
+		Features |= SF_Debug;
+	}
+#endif
+	return Features;
+}
+
+template<uint32 ExtraFeatures>
+UCollisionAnticipationSpringArm::FSolverKernel UCollisionAnticipationSpringArm::GetSolverKernelWith(uint32 Features)
+{
+	if (Features & SF_Generic)
+	{
+		return &UCollisionAnticipationSpringArm::SolveArm<SF_Generic | ExtraFeatures>;
+	}
+
+	//one instantiation of the solver for every combination of features
+	struct FKernelTable
+	{
+		FSolverKernel Kernels[SolverKernelCount];
+	};
+	static const FKernelTable Table = []<uint32... Masks>(std::integer_sequence<uint32, Masks...>)
+	{
+		return FKernelTable{ { &UCollisionAnticipationSpringArm::SolveArm<Masks | ExtraFeatures>... } };
+	}(std::make_integer_sequence<uint32, SolverKernelCount>());
+
+	return Table.Kernels[Features & (SolverKernelCount - 1)];
+}
+
+UCollisionAnticipationSpringArm::FSolverKernel UCollisionAnticipationSpringArm::GetSolverKernel(uint32 Features)
+{
+	return GetSolverKernelWith<0>(Features);
+}
+
+#if !UE_BUILD_SHIPPING
+void UCollisionAnticipationSpringArm::RunSolverBenchmark(UWorld* World, int32 Iterations)
+{
+	for (TObjectIterator<UCollisionAnticipationSpringArm> It; It; ++It)
+	{
+		UCollisionAnticipationSpringArm* Arm = *It;
+		if (Arm->GetWorld() != World || !Arm->IsRegistered() || !Arm->IsCameraViewable())
+		{
+			continue;
+		}
+
+		const float DeltaTime = FMath::Max(World->GetDeltaSeconds(), 1.f / 60.f);
+		const uint32 Features = Arm->ComputeSettingsSolverFeatures() | (Arm->bDoCollisionTest ? SF_Collide : 0) | (Arm->bDoCollisionPrediction ? SF_Predict : 0);
+
+		//both kernels start from the same state, and the arm is left as we found it
+		const FArmViewState SavedMainViewState = Arm->MainViewState;
+		const TMap<FName, FArmViewState> SavedAdditionalViewStates = Arm->AdditionalViewStates;
+		auto RestoreState = [&]()
+		{
+			Arm->MainViewState = SavedMainViewState;
+			Arm->AdditionalViewStates = SavedAdditionalViewStates;
+		};
+
+		//the previous camera location alternates from one side to the other so the prediction fan runs on every iteration
+		const FVector SideStep = FRotationMatrix(Arm->GetTargetRotation()).GetUnitAxis(EAxis::Y) * 10.f;
+		const FVector RestLocation = SavedMainViewState.PreviousDesiredLoc;
+
+		auto TimeKernel = [&](FSolverKernel Kernel)
+		{
+			RestoreState();
+			const double StartTime = FPlatformTime::Seconds();
+			for (int32 i = 0; i < Iterations; ++i)
+			{
+				Arm->MainViewState.PreviousDesiredLoc = RestLocation + ((i & 1) ? SideStep : -SideStep);
+				(Arm->*Kernel)(DeltaTime, Features);
+			}
+			return (FPlatformTime::Seconds() - StartTime) * 1000000.0 / Iterations;
+		};
+
+		//scene queries and transform propagation would hide the difference between the kernels, so the timed kernels are built without them
+		const double GenericTime = TimeKernel(GetSolverKernelWith<SF_StubSceneQueries>(Features | SF_Generic));
+		const double SpecializedTime = TimeKernel(GetSolverKernelWith<SF_StubSceneQueries>(Features));
+
+		RestoreState();
+		Arm->bSolverSettled = false;
+		Arm->UpdateChildTransforms();
+
+		UE_LOG(LogCameraArm, Display, TEXT("%s: generic %.3f us, specialized %.3f us per update (features 0x%02x, %d iterations)"),
+			*Arm->GetPathName(), GenericTime, SpecializedTime, Features, Iterations);
+	}
+}
+#endif
+
+template<uint32 Features>
+void UCollisionAnticipationSpringArm::SolveArm(float DeltaTime, uint32 RuntimeFeatures)
+{
+	// If our viewtarget is simulating using physics, we may need to clamp deltatime
+	if constexpr (SolverFeatureCompiledIn<Features, SF_ClampDeltaTime>)
+	{
+		if (HasSolverFeature<Features, SF_ClampDeltaTime>(RuntimeFeatures))
+		{
+			// Use the same max timestep cap as the physics system to avoid camera jitter when the viewtarget simulates less time than the camera
+			DeltaTime = FMath::Min(DeltaTime, UPhysicsSettings::Get()->MaxPhysicsDeltaTime);
+		}
+	}
+
+	// Get the spring arm 'origin', the target we want to look at (without offset), it is the same for every view
+	const FVector ArmOrigin = GetComponentLocation();
+	const FTransform ComponentTransform = GetComponentTransform();
+	const FRotator TargetRot = GetTargetRotation();
+
+	if constexpr ((SolverFeatureCompiledIn<Features, SF_Predict> || SolverFeatureCompiledIn<Features, SF_Collide>) && !(Features & SF_StubSceneQueries))
+	{
+		if (HasSolverFeature<Features, SF_Predict>(RuntimeFeatures) || HasSolverFeature<Features, SF_Collide>(RuntimeFeatures))
+		{
+			//the filter has to cover the longest view
+			float FilterRadius = TargetArmLength + SocketOffset.Size();
+			for (int32 ViewIndex = 0; ViewIndex < AdditionalViews.Num(); ++ViewIndex)
+			{
+				if (IsValidView(ViewIndex))
+				{
+					FilterRadius = FMath::Max(FilterRadius, AdditionalViews[ViewIndex].ArmLength + AdditionalViews[ViewIndex].SocketOffset.Size());
+				}
+			}
+			UpdateBlockerFilter(ArmOrigin, FilterRadius + SphereTraceSize, DeltaTime);
+		}
+	}
+
+	//the traces of a frame are only shared between the views of that frame
+	SharedTraces.Reset();
+
+	FArmViewRequest MainView;
+	MainView.Rotation = TargetRot;
+	MainView.Offset = bIsOffset ? SocketOffset : FVector::Zero();
+	MainView.ArmLength = TargetArmLength;
+	bool bAllViewsSettled = SolveView<Features>(MainView, MainViewState, ArmOrigin, ComponentTransform, DeltaTime, RuntimeFeatures);
+
+	//view states are keyed by socket name so reordering or removing views doesn't hand a state to another view
+	int32 ValidViewCount = 0;
+	for (int32 ViewIndex = 0; ViewIndex < AdditionalViews.Num(); ++ViewIndex)
+	{
+		//two views can't share a socket, nor take the one of the main view
+		if (!IsValidView(ViewIndex))
+		{
+			continue;
+		}
+		++ValidViewCount;
+
+		const FCameraArmView& View = AdditionalViews[ViewIndex];
+		FArmViewState* ViewState = AdditionalViewStates.Find(View.SocketName);
+		if (!ViewState)
+		{
+			//new views start directly at their offset instead of blending in from the arm
+			ViewState = &AdditionalViewStates.Add(View.SocketName);
+			ViewState->PreviousOffset = View.SocketOffset;
+		}
+
+		FArmViewRequest ViewRequest;
+		ViewRequest.Rotation = ComposeViewRotation(TargetRot, View.RotationOffset);
+		ViewRequest.Offset = View.SocketOffset;
+		ViewRequest.ArmLength = View.ArmLength;
+		bAllViewsSettled &= SolveView<Features>(ViewRequest, *ViewState, ArmOrigin, ComponentTransform, DeltaTime, RuntimeFeatures);
+	}
+
+	//forget the states of views that were removed or renamed, every valid view has exactly one state so any extra one is stale
+	if (AdditionalViewStates.Num() > ValidViewCount)
+	{
+		for (auto It = AdditionalViewStates.CreateIterator(); It; ++It)
+		{
+			if (!DoesSocketExist(It.Key()))
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	bSolverSettled = bAllViewsSettled;
+
+	if constexpr (!(Features & SF_StubSceneQueries))
+	{
+		UpdateChildTransforms();
 	}
+}
 
-	FRotator DesiredRot = GetTargetRotation();
+template<uint32 Features>
+bool UCollisionAnticipationSpringArm::SolveView(const FArmViewRequest& View, FArmViewState& State, const FVector& ArmOrigin, const FTransform& ComponentTransform, float DeltaTime, uint32 RuntimeFeatures)
+{
+	const FRotator& DesiredRot = View.Rotation;
 	FVector DesiredRotForward = DesiredRot.Vector();
 
 	//smoothly move the camera in or out of its offset 
-	FVector DesiredOffset = bIsOffset ? SocketOffset : FVector::Zero();
+	const FVector& DesiredOffset = View.Offset;
 	FVector ResultOffset = DesiredOffset;
-	if (!PreviousOffset.Equals(DesiredOffset))
+	if (!State.PreviousOffset.Equals(DesiredOffset))
 	{
-		ResultOffset = FMath::VInterpTo(PreviousOffset, DesiredOffset, DeltaTime, 1);
+		ResultOffset = FMath::VInterpTo(State.PreviousOffset, DesiredOffset, DeltaTime, 1);
 	}
-	PreviousOffset = ResultOffset;
+	State.PreviousOffset = ResultOffset;
 
-	// Get the spring arm 'origin', the target we want to look at (without offset)
-	FVector ArmOrigin = GetComponentLocation();
 	// get the desired location of the camera without collisions
-	FVector DesiredLoc = ArmOrigin - DesiredRotForward * TargetArmLength;
+	FVector DesiredLoc = ArmOrigin - DesiredRotForward * View.ArmLength;
 	// Add socket offset in local space
 	DesiredLoc += FRotationMatrix(DesiredRot).TransformVector(ResultOffset);
 	//the new length of the arm with added offset
@@ -145,100 +468,111 @@ void UCollisionAnticipationSpringArm::UpdateDesiredArmLocation(bool bDoCollision
 
 	ResultLoc = DesiredLoc;
 
+	// true while the return delay keeps the camera where it is, the solver is not settled until it runs out
+	bool bHoldingPosition = false;
+	// where the prediction wants the camera to end up, and whether the collision test is what holds the camera instead
+	float TargetForwardMovement = 0;
+	bool bPinnedByCollision = false;
+
 	// Do collision prediction first
-	if (bPredictCollisions && (OffsetArmLength != 0.0f))
+	if constexpr (SolverFeatureCompiledIn<Features, SF_Predict>)
 	{
-		FCollisionPredictionResult PredictionResults;
+		if (HasSolverFeature<Features, SF_Predict>(RuntimeFeatures) && (OffsetArmLength != 0.0f))
+		{
+			FCollisionPredictionResult PredictionResults;
 
-		//first check if the camera is moving left or right with a dot product of the camera movement vector and its right vector in 2D
-		FVector LastCameraMovement = PreviousDesiredLoc - DesiredLoc;
-		FVector2D LastCamMovement2D(LastCameraMovement.X, LastCameraMovement.Y);
-		FVector CameraRightVector = FRotationMatrix(DesiredRot).GetUnitAxis(EAxis::Y);
-		FVector2D CamRightVector2D(CameraRightVector.X, CameraRightVector.Y);//camera has no roll, so right vector will never have a Z and we can just convert it to 2D like this and keep it normalized
-		
-		LastCamMovement2D.Normalize();
+			//first check if the camera is moving left or right with a dot product of the camera movement vector and its right vector in 2D
+			FVector LastCameraMovement = State.PreviousDesiredLoc - DesiredLoc;
+			FVector2D LastCamMovement2D(LastCameraMovement.X, LastCameraMovement.Y);
+			FVector CameraRightVector = FRotationMatrix(DesiredRot).GetUnitAxis(EAxis::Y);
+			FVector2D CamRightVector2D(CameraRightVector.X, CameraRightVector.Y);//camera has no roll, so right vector will never have a Z and we can just convert it to 2D like this and keep it normalized
+			
+			LastCamMovement2D.Normalize();
 
-		float DotProd = FVector2D::DotProduct(CamRightVector2D, LastCamMovement2D);
-		FString debugText = FString::Printf(TEXT("%d"), bIsOffset);
+			float DotProd = FVector2D::DotProduct(CamRightVector2D, LastCamMovement2D);
 
-		//Horizontal Collision Prediction
-		if (!FMath::IsNearlyZero(DotProd))
-		{
-			//check collisions to the left
-			if (DotProd > 0.0f)
+			//Horizontal Collision Prediction
+			if (!FMath::IsNearlyZero(DotProd))
 			{
-				CheckSurroundingWallsCollisions(PredictionResults, OffsetRot, OffsetArmLength, PredictionStartAngle, PredictionEndAngle, TracesPerSide);
+				//check collisions to the left, or to the right by mirroring the fan angles
+				const float Side = DotProd > 0.0f ? 1.0f : -1.0f;
+				CheckSurroundingWallsCollisions<Features & (SF_PositionCurve | SF_Debug | SF_Generic | SF_StubSceneQueries)>(PredictionResults, OffsetRot, OffsetArmLength, View.ArmLength, Side * PredictionStartAngle, Side * PredictionEndAngle, TracesPerSide, RuntimeFeatures);
 			}
-			else//or to the right
+
+			float moveSpeed = CorrectionSpeedForward;
+			if constexpr (SolverFeatureCompiledIn<Features, SF_SpeedCurve>)
 			{
-				CheckSurroundingWallsCollisions(PredictionResults, OffsetRot, OffsetArmLength, -PredictionStartAngle, -PredictionEndAngle, TracesPerSide);
+				if (HasSolverFeature<Features, SF_SpeedCurve>(RuntimeFeatures))
+				{
+					moveSpeed *= SpeedCurve->GetFloatValue(PredictionResults.CorrectionStrength);
+				}
 			}
-		}
-
-		float moveSpeed = CorrectionSpeedForward;
-		if (bUseSpeedCurve && IsValid(SpeedCurve))
-		{
-			moveSpeed *= SpeedCurve->GetFloatValue(PredictionResults.CorrectionStrength);
-		}
-
-		float PositionFixDistance = 0;
 
-		//if the camera wants to go back because it has space behind, run a small timer before letting it to avoid weird back and forth
-		if (PredictionResults.PredictedMoveDistance <= PreviousForwardMovement)
-		{
-			//decided to move the camera at a different and slower speed when going back compared to going forward
-			moveSpeed = CorrectionSpeedBack;
-			if (ReturnTimer < ReturnDelay)
+			//if the camera wants to go back because it has space behind, run a small timer before letting it to avoid weird back and forth
+			if (PredictionResults.PredictedMoveDistance <= State.PreviousForwardMovement)
 			{
-				PredictionResults.PredictedMoveDistance = PreviousForwardMovement;// block position to previous one until timer runs out
-				ReturnTimer += DeltaTime;
+				//decided to move the camera at a different and slower speed when going back compared to going forward
+				moveSpeed = CorrectionSpeedBack;
+				if (State.ReturnTimer < ReturnDelay)
+				{
+					PredictionResults.PredictedMoveDistance = State.PreviousForwardMovement;// block position to previous one until timer runs out
+					State.ReturnTimer += DeltaTime;
+					bHoldingPosition = true;
+				}
+			}
+			else
+			{
+				State.ReturnTimer = 0;
 			}
-		}
-		else
-		{
-			ReturnTimer = 0;
-		}
 
-		//interpolate the forward movement of the camera to avoid walls smoothly
-		ResultForwardMovement = FMath::FInterpTo(PreviousForwardMovement, PredictionResults.PredictedMoveDistance, DeltaTime, moveSpeed);
-		ResultLoc = DesiredLoc + OffsetArmForward * ResultForwardMovement;
+			//interpolate the forward movement of the camera to avoid walls smoothly
+			TargetForwardMovement = PredictionResults.PredictedMoveDistance;
+			ResultForwardMovement = FMath::FInterpTo(State.PreviousForwardMovement, PredictionResults.PredictedMoveDistance, DeltaTime, moveSpeed);
+			ResultLoc = DesiredLoc + OffsetArmForward * ResultForwardMovement;
+		}
 	}
 
 	//we can do a plain old collision detection, this "wins" over the prediction position if the smooth movement is not enough to get us in front of a wall, so we don't see in the walls
-	if (bDoCollision)
+	if constexpr (SolverFeatureCompiledIn<Features, SF_Collide>)
 	{
-		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(SpringArm), false, GetOwner());
-		FHitResult Result;
-		GetWorld()->SweepSingleByChannel(Result, ArmOrigin, ResultLoc, FQuat::Identity, TraceChannel, FCollisionShape::MakeSphere(SphereTraceSize), QueryParams);
-
-		if (Result.bBlockingHit)
+		if (HasSolverFeature<Features, SF_Collide>(RuntimeFeatures))
 		{
-			float BaseCollisionMoveDistance = OffsetArmLength - Result.Distance;
-			if (BaseCollisionMoveDistance > ResultForwardMovement)
+			float HitDistance;
+			if (TraceFromOrigin<Features>(ArmOrigin, ResultLoc, true, HitDistance))
 			{
-				ResultForwardMovement = BaseCollisionMoveDistance;
+				float BaseCollisionMoveDistance = OffsetArmLength - HitDistance;
+				if (BaseCollisionMoveDistance >= ResultForwardMovement)
+				{
+					ResultForwardMovement = BaseCollisionMoveDistance;
+					bPinnedByCollision = true;
+				}
 			}
-		}
 
-		ResultLoc = DesiredLoc + OffsetArmForward * ResultForwardMovement;
+			ResultLoc = DesiredLoc + OffsetArmForward * ResultForwardMovement;
+		}
 	}
 
-	PreviousForwardMovement = ResultForwardMovement;
-	PreviousDesiredLoc = DesiredLoc;
+	//the camera has nowhere left to go on its own: the offset is done blending and the forward movement reached its target, or a wall decides it
+	const bool bForwardMovementSettled = bPinnedByCollision || FMath::IsNearlyEqual(ResultForwardMovement, TargetForwardMovement, SettledForwardMovementTolerance);
+	const bool bSettled = !bHoldingPosition && ResultOffset.Equals(DesiredOffset) && bForwardMovementSettled;
+
+	State.PreviousForwardMovement = ResultForwardMovement;
+	State.PreviousDesiredLoc = DesiredLoc;
 
 	// Form a transform for new world transform for camera
 	FTransform WorldCamTM(DesiredRot, ResultLoc);
 	// Convert to relative to component
-	FTransform RelCamTM = WorldCamTM.GetRelativeTransform(GetComponentTransform());
+	FTransform RelCamTM = WorldCamTM.GetRelativeTransform(ComponentTransform);
 
 	// Update socket location/rotation
-	RelativeSocketLocation = RelCamTM.GetLocation();
-	RelativeSocketRotation = RelCamTM.GetRotation();
+	State.RelativeSocketLocation = RelCamTM.GetLocation();
+	State.RelativeSocketRotation = RelCamTM.GetRotation();
 
-	UpdateChildTransforms();
+	return bSettled;
 }
 
-bool UCollisionAnticipationSpringArm::CheckSurroundingWallsCollisions(FCollisionPredictionResult& OutResult, const FRotator& CameraRotation, float ArmLength, float StartAngle, float EndAngle, int TraceCount)
+template<uint32 Features>
+bool UCollisionAnticipationSpringArm::CheckSurroundingWallsCollisions(FCollisionPredictionResult& OutResult, const FRotator& CameraRotation, float ArmLength, float NominalArmLength, float StartAngle, float EndAngle, int TraceCount, uint32 RuntimeFeatures)
 {
 	OutResult.bHitSomething = false;
 	OutResult.CorrectionStrength = 0;
@@ -260,20 +594,22 @@ bool UCollisionAnticipationSpringArm::CheckSurroundingWallsCollisions(FCollision
 		FVector TraceDirection = QuatRotation.RotateVector(CameraRotation.Vector());
 		FVector TraceEnd = ArmOrigin + (TraceDirection * ArmLength);
 
-		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(SpringArm), false, GetOwner());
-		FHitResult Result;
-		GetWorld()->LineTraceSingleByChannel(Result, ArmOrigin, TraceEnd, TraceChannel, QueryParams);
+		float HitDistance;
+		const bool bBlockingHit = TraceFromOrigin<Features>(ArmOrigin, TraceEnd, false, HitDistance);
 
-		if (Result.bBlockingHit)
+		if (bBlockingHit)
 		{
 			//get a ratio on how far an angle the wall is from our current position (1 for the closest trace to us, 1 / TraceCount for the furthest)
 			float CorrectionStrength = (TraceCount - i) / (float)TraceCount;
 			
-			float moveDistance = (TargetArmLength - Result.Distance);
+			float moveDistance = (NominalArmLength - HitDistance);
 
-			if (bUsePositionCurve && IsValid(PositionCurve))
+			if constexpr (SolverFeatureCompiledIn<Features, SF_PositionCurve>)
 			{
-				moveDistance *= PositionCurve->GetFloatValue(CorrectionStrength);
+				if (HasSolverFeature<Features, SF_PositionCurve>(RuntimeFeatures))
+				{
+					moveDistance *= PositionCurve->GetFloatValue(CorrectionStrength);
+				}
 			}
 
 			//only keep the data if it is the biggest correction found so far
@@ -284,23 +620,116 @@ bool UCollisionAnticipationSpringArm::CheckSurroundingWallsCollisions(FCollision
 				OutResult.PredictedMoveDistance = moveDistance;
 				OutResult.CorrectionStrength = CorrectionStrength;
 			}
-
-			//draw line a bit below so we can see it (else it goes straight in the camera and all lines are superposed when playing)
-			if(bShowDebugInfo)
-				DrawDebugLine(GetWorld(), ArmOrigin + FVector::UpVector * -20, TraceEnd + FVector::UpVector * -20, FColor::Red, false, 0.0f, 0, 1.0f);
 		}
-		else
+
+		//draw line a bit below so we can see it (else it goes straight in the camera and all lines are superposed when playing)
+		if constexpr (SolverFeatureCompiledIn<Features, SF_Debug>)
 		{
-			if(bShowDebugInfo)
-				DrawDebugLine(GetWorld(), ArmOrigin + FVector::UpVector * -20, TraceEnd + FVector::UpVector * -20, FColor::Green, false, 0.0f, 0, 1.0f);
+			if (HasSolverFeature<Features, SF_Debug>(RuntimeFeatures))
+			{
+				DrawDebugLine(GetWorld(), ArmOrigin + FVector::UpVector * -20, TraceEnd + FVector::UpVector * -20, bBlockingHit ? FColor::Red : FColor::Green, false, 0.0f, 0, 1.0f);
+			}
 		}
 	}
 	return OutResult.bHitSomething;
 }
 
+template<uint32 Features>
+bool UCollisionAnticipationSpringArm::TraceFromOrigin(const FVector& ArmOrigin, const FVector& TraceEnd, bool bSweep, float& OutHitDistance)
+{
+	FVector Direction;
+	float Length;
+	(TraceEnd - ArmOrigin).ToDirectionAndLength(Direction, Length);
+
+	//benchmark only: every trace hits halfway so both kernels do the same work without touching the physics scene
+	if constexpr ((Features & SF_StubSceneQueries) != 0)
+	{
+		OutHitDistance = Length * 0.5f;
+		return true;
+	}
+
+	//every trace starts at the arm origin, so a trace of another view going the same way at least as far already knows the answer
+	const bool bShareTraces = AdditionalViews.Num() > 0;
+	if (bShareTraces)
+	{
+		const float MinDirectionDot = FMath::Cos(FMath::DegreesToRadians(SharedTraceAngleTolerance));
+		for (const FSharedTrace& Trace : SharedTraces)
+		{
+			if (Trace.bSweep == bSweep && Trace.Length >= Length && FVector::DotProduct(Trace.Direction, Direction) >= MinDirectionDot)
+			{
+				OutHitDistance = Trace.HitDistance;
+				return Trace.HitDistance >= 0 && Trace.HitDistance <= Length;
+			}
+		}
+	}
+
+	FHitResult Result;
+	if (bSweep)
+	{
+		GetWorld()->SweepSingleByChannel(Result, ArmOrigin, TraceEnd, FQuat::Identity, TraceChannel, FCollisionShape::MakeSphere(SphereTraceSize), SweepQueryParams);
+	}
+	else
+	{
+		GetWorld()->LineTraceSingleByChannel(Result, ArmOrigin, TraceEnd, TraceChannel, PredictionQueryParams);
+	}
+
+	OutHitDistance = Result.bBlockingHit ? Result.Distance : -1.f;
+	if (bShareTraces)
+	{
+		SharedTraces.Add({ Direction, Length, OutHitDistance, bSweep });
+	}
+	return Result.bBlockingHit;
+}
+
+FTransform UCollisionAnticipationSpringArm::GetRelativeSocketTransform(FName InSocketName) const
+{
+	const int32 ViewIndex = FindViewIndex(InSocketName);
+	if (ViewIndex != INDEX_NONE)
+	{
+		if (const FArmViewState* ViewState = AdditionalViewStates.Find(InSocketName))
+		{
+			return FTransform(ViewState->RelativeSocketRotation, ViewState->RelativeSocketLocation);
+		}
+
+		//not solved yet, or added while the arm sleeps: put it where it would be without any collision rather than on the main view
+		const FCameraArmView& View = AdditionalViews[ViewIndex];
+		const FRotator ViewRot = ComposeViewRotation(GetTargetRotation(), View.RotationOffset);
+		const FVector ViewLoc = GetComponentLocation() - ViewRot.Vector() * View.ArmLength + FRotationMatrix(ViewRot).TransformVector(View.SocketOffset);
+		return FTransform(ViewRot, ViewLoc).GetRelativeTransform(GetComponentTransform());
+	}
+	return FTransform(MainViewState.RelativeSocketRotation, MainViewState.RelativeSocketLocation);
+}
+
+int32 UCollisionAnticipationSpringArm::FindViewIndex(FName InSocketName) const
+{
+	if (InSocketName == NAME_None || InSocketName == SocketName)
+	{
+		return INDEX_NONE;
+	}
+	//the first view using a name owns it, the same rule as IsValidView
+	return AdditionalViews.IndexOfByPredicate([InSocketName](const FCameraArmView& View) { return View.SocketName == InSocketName; });
+}
+
+bool UCollisionAnticipationSpringArm::IsValidView(int32 ViewIndex) const
+{
+	const FName ViewSocketName = AdditionalViews[ViewIndex].SocketName;
+	if (FindViewIndex(ViewSocketName) == ViewIndex)
+	{
+		return true;
+	}
+
+	if (!bWarnedInvalidView)
+	{
+		bWarnedInvalidView = true;
+		UE_LOG(LogCameraArm, Warning, TEXT("%s: additional view %d is ignored, its socket name '%s' is empty, the main socket or already used by another view"),
+			*GetPathName(), ViewIndex, *ViewSocketName.ToString());
+	}
+	return false;
+}
+
 FTransform UCollisionAnticipationSpringArm::GetSocketTransform(FName InSocketName, ERelativeTransformSpace TransformSpace) const
 {
-	FTransform RelativeTransform(RelativeSocketRotation, RelativeSocketLocation);
+	FTransform RelativeTransform = GetRelativeSocketTransform(InSocketName);
 
 	switch (TransformSpace)
 	{
@@ -330,9 +759,21 @@ bool UCollisionAnticipationSpringArm::HasAnySockets() const
 	return true;
 }
 
+bool UCollisionAnticipationSpringArm::DoesSocketExist(FName InSocketName) const
+{
+	return InSocketName == SocketName || FindViewIndex(InSocketName) != INDEX_NONE;
+}
+
 void UCollisionAnticipationSpringArm::QuerySupportedSockets(TArray<FComponentSocketDescription>& OutSockets) const
 {
 	new (OutSockets) FComponentSocketDescription(SocketName, EComponentSocketType::Socket);
+	for (int32 ViewIndex = 0; ViewIndex < AdditionalViews.Num(); ++ViewIndex)
+	{
+		if (IsValidView(ViewIndex))
+		{
+			new (OutSockets) FComponentSocketDescription(AdditionalViews[ViewIndex].SocketName, EComponentSocketType::Socket);
+		}
+	}
 }
 
 void UCollisionAnticipationSpringArm::ToggleSocketOffset()
@@ -345,7 +786,282 @@ void UCollisionAnticipationSpringArm::Zoom(float value)
 	TargetArmLength = FMath::Clamp(TargetArmLength + value * ZoomSpeed, MinZoom, MaxZoom);
 }
 
+void UCollisionAnticipationSpringArm::UpdateBlockerFilter(const FVector& ArmOrigin, float Radius, float DeltaTime)
+{
+	const EQueryMobilityType PredictionMobility = bPredictStaticOnly ? EQueryMobilityType::Static : EQueryMobilityType::Any;
+	if (bQueryParamsDirty || PredictionQueryParams.MobilityType != PredictionMobility)
+	{
+		RebuildQueryParams();
+	}
+
+	if (!bFilterCameraBlockers)
+	{
+		//the filter may have been turned off at runtime, stop ignoring anything
+		if (IgnoredBlockers.Num() > 0)
+		{
+			IgnoredBlockers.Empty();
+			RebuildQueryParams();
+		}
+		return;
+	}
+
+	BlockerFilterTimer -= DeltaTime;
+	if (BlockerFilterTimer > 0)
+	{
+		return;
+	}
+	BlockerFilterTimer = BlockerFilterRefreshInterval;
+
+	TArray<FOverlapResult> Overlaps;
+	FCollisionQueryParams OverlapParams(SCENE_QUERY_STAT(SpringArmFilter), false, GetOwner());
+	GetWorld()->OverlapMultiByChannel(Overlaps, ArmOrigin, FQuat::Identity, TraceChannel, FCollisionShape::MakeSphere(Radius), OverlapParams);
+
+	TSet<TWeakObjectPtr<UPrimitiveComponent>> InRange;
+	InRange.Reserve(Overlaps.Num());
+	bool bRebuildQueryParams = false;
+	for (const FOverlapResult& Overlap : Overlaps)
+	{
+		UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (!Component)
+		{
+			continue;
+		}
+
+		TWeakObjectPtr<UPrimitiveComponent> Key(Component);
+		InRange.Add(Key);
+
+		//primitives are checked again on every refresh, their tags, type or bounds may have changed while in range
+		if (IsRelevantBlocker(Component))
+		{
+			//the query params can't forget a single component, so they are rebuilt below
+			bRebuildQueryParams |= IgnoredBlockers.Remove(Key) > 0;
+		}
+		else
+		{
+			bool bAlreadyIgnored = false;
+			IgnoredBlockers.Add(Key, &bAlreadyIgnored);
+			if (!bAlreadyIgnored)
+			{
+				SweepQueryParams.AddIgnoredComponent(Component);
+				PredictionQueryParams.AddIgnoredComponent(Component);
+			}
+		}
+	}
+
+	for (auto It = IgnoredBlockers.CreateIterator(); It; ++It)
+	{
+		if (!InRange.Contains(*It))
+		{
+			It.RemoveCurrent();
+			bRebuildQueryParams = true;
+		}
+	}
+
+	if (bRebuildQueryParams)
+	{
+		RebuildQueryParams();
+	}
+}
+
+void UCollisionAnticipationSpringArm::InvalidateBlockerFilter()
+{
+	IgnoredBlockers.Empty();
+	BlockerFilterTimer = 0;
+	bQueryParamsDirty = true;
+}
+
+bool UCollisionAnticipationSpringArm::IsRelevantBlocker(const UPrimitiveComponent* Component) const
+{
+	if (Component->Bounds.SphereRadius < MinBlockerSize)
+	{
+		return false;
+	}
+
+	if (IgnoredBlockerObjectTypes.Contains(Component->GetCollisionObjectType()))
+	{
+		return false;
+	}
+
+	const AActor* ComponentOwner = Component->GetOwner();
+	for (const FName& Tag : IgnoredBlockerTags)
+	{
+		if (Component->ComponentHasTag(Tag) || (ComponentOwner && ComponentOwner->ActorHasTag(Tag)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void UCollisionAnticipationSpringArm::RebuildQueryParams()
+{
+	SweepQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(SpringArm), false, GetOwner());
+	for (const TWeakObjectPtr<UPrimitiveComponent>& Ignored : IgnoredBlockers)
+	{
+		if (Ignored.IsValid())
+		{
+			SweepQueryParams.AddIgnoredComponent(Ignored.Get());
+		}
+	}
+
+	PredictionQueryParams = SweepQueryParams;
+	PredictionQueryParams.MobilityType = bPredictStaticOnly ? EQueryMobilityType::Static : EQueryMobilityType::Any;
+
+	bQueryParamsDirty = false;
+}
+
+void UCollisionAnticipationSpringArm::SetUseSpeedCurve(bool bUse)
+{
+	bUseSpeedCurve = bUse;
+	MarkSolverFeaturesDirty();
+}
+
+void UCollisionAnticipationSpringArm::SetUsePositionCurve(bool bUse)
+{
+	bUsePositionCurve = bUse;
+	MarkSolverFeaturesDirty();
+}
+
+void UCollisionAnticipationSpringArm::SetClampToMaxPhysicsDeltaTime(bool bClamp)
+{
+	bClampToMaxPhysicsDeltaTime = bClamp;
+	MarkSolverFeaturesDirty();
+}
+
+void UCollisionAnticipationSpringArm::MarkSolverFeaturesDirty()
+{
+	bSolverFeaturesDirty = true;
+}
+
+bool UCollisionAnticipationSpringArm::ComputeCameraViewable() const
+{
+	if (!bDisableWhenNotViewable)
+	{
+		return true;
+	}
+
+	//always keep the arm alive in editor viewports so the preview still works
+	const UWorld* World = GetWorld();
+	if (!World || !World->IsGameWorld())
+	{
+		return true;
+	}
+
+	if (GetNetMode() == NM_DedicatedServer)
+	{
+		return false;
+	}
+
+	const AActor* Owner = GetOwner();
+	if (!Owner)
+	{
+		return true;
+	}
+
+	if (Owner->GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		return false;
+	}
+
+	//an unpossessed pawn can still be used as a view target, so only strip pawns driven from another machine
+	if (const APawn* OwningPawn = Cast<APawn>(Owner))
+	{
+		if (OwningPawn->GetController() && !OwningPawn->IsLocallyControlled())
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void UCollisionAnticipationSpringArm::RefreshViewableState()
+{
+	const bool bViewable = ComputeCameraViewable();
+
+	//registering the tick functions at BeginPlay turns the tick back on, so force it off even if nothing changed
+	if (!bViewable)
+	{
+		SetComponentTickEnabled(false);
+	}
+
+	if (bViewable == bCameraViewable)
+	{
+		return;
+	}
+
+	bCameraViewable = bViewable;
+	ResetArmState();
+
+	//only tick again if the component would have ticked without us, it may have been deactivated or set to start without tick
+	if (bViewable && IsActive() && PrimaryComponentTick.bStartWithTickEnabled)
+	{
+		SetComponentTickEnabled(true);
+	}
+
+	if (bViewable && IsRegistered())
+	{
+		//snap straight to a safe position instead of blending from wherever the arm was left when it went to sleep
+		UpdateDesiredArmLocation(bDoCollisionTest, false, 0.f);
+	}
+}
+
+void UCollisionAnticipationSpringArm::ResetArmState()
+{
+	//keep every socket where it is, the children stay there while the arm sleeps
+	auto ResetViewState = [](FArmViewState& ViewState, const FVector& Offset)
+	{
+		FArmViewState FreshState;
+		FreshState.PreviousOffset = Offset;
+		FreshState.RelativeSocketLocation = ViewState.RelativeSocketLocation;
+		FreshState.RelativeSocketRotation = ViewState.RelativeSocketRotation;
+		ViewState = FreshState;
+	};
+
+	ResetViewState(MainViewState, bIsOffset ? SocketOffset : FVector::ZeroVector);
+	for (TPair<FName, FArmViewState>& ViewState : AdditionalViewStates)
+	{
+		ResetViewState(ViewState.Value, ViewState.Value.PreviousOffset);
+	}
+	SharedTraces.Empty();
+
+	//free the filter caches, they are rebuilt from scratch on the next collision update
+	IgnoredBlockers.Empty();
+	SweepQueryParams = FCollisionQueryParams();
+	PredictionQueryParams = FCollisionQueryParams();
+	BlockerFilterTimer = 0;
+	bQueryParamsDirty = true;
+
+	bSolverSettled = false;
+	IdleRevalidationTimer = 0;
+}
+
 #if WITH_EDITOR
+void UCollisionAnticipationSpringArm::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	//any setting can move the camera, run the solver again even if the arm itself didn't move
+	MarkSolverFeaturesDirty();
+	bSolverSettled = false;
+
+	const FName PropertyName = PropertyChangedEvent.GetMemberPropertyName();
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UCollisionAnticipationSpringArm, MinBlockerSize)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UCollisionAnticipationSpringArm, IgnoredBlockerTags)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UCollisionAnticipationSpringArm, IgnoredBlockerObjectTypes)
+		|| PropertyName == GET_MEMBER_NAME_CHECKED(UCollisionAnticipationSpringArm, TraceChannel))
+	{
+		InvalidateBlockerFilter();
+	}
+
+	//the views were edited, warn again if they are still misnamed
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UCollisionAnticipationSpringArm, AdditionalViews))
+	{
+		bWarnedInvalidView = false;
+	}
+}
+
 //quickly hacked function to preview the collision prediction line traces inside the blueprint viewport
 void UCollisionAnticipationSpringArm::ShowPreviewLines()
 {
@@ -2,8 +2,32 @@
 
 #include "CoreMinimal.h"
 #include "Components/SceneComponent.h"
+#include "CollisionQueryParams.h"
 #include "CollisionAnticipationSpringArm.generated.h"
 
+/** An extra camera view coming out of the same arm origin, exposed as its own socket on the arm */
+USTRUCT(BlueprintType)
+struct FCameraArmView
+{
+	GENERATED_BODY()
+
+	/** Name of the socket at the end of this view, attach a camera or a scene capture to it */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera)
+	FName SocketName;
+
+	/** Natural length of the arm for this view when there are no collisions */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera, meta = (ClampMin = "50.0", ClampMax = "1000.0", UIMin = "50.0", UIMax = "1000.0"))
+	float ArmLength = 400.f;
+
+	/** offset at end of the arm for this view */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera)
+	FVector SocketOffset = FVector::ZeroVector;
+
+	/** rotation added on top of the target rotation of the arm, for example a yaw of 180 for a rear view */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera)
+	FRotator RotationOffset = FRotator::ZeroRotator;
+};
+
 //Originally this was inherited from USpringArmComponent, but I just removed too much useless stuff for my purpose so I decided to make a different class, though a lot of it is inspired from USpringArmComponent
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
 class UBITEST_API UCollisionAnticipationSpringArm : public USceneComponent
@@ -29,6 +53,28 @@ protected:
 		uint8 bHitSomething:1;
 	};
 
+public:
+
+	/** Optional parts of the arm solver, each combination is compiled into its own kernel so the solver never checks the settings while it runs */
+	enum ESolverFeature : uint32
+	{
+		SF_ClampDeltaTime = 1 << 0,
+		SF_Predict = 1 << 1,
+		SF_Collide = 1 << 2,
+		SF_SpeedCurve = 1 << 3,
+		SF_PositionCurve = 1 << 4,
+		SF_Debug = 1 << 5,
+		//not a feature: the kernel reads the features at runtime instead, used as the reference for benchmarking
+		SF_Generic = 1 << 7,
+		//not a feature: benchmark only, traces return a fixed answer and children are not moved so only the kernel is timed
+		SF_StubSceneQueries = 1 << 8,
+	};
+
+	/** Number of specialized kernels, one per combination of the features below SF_Generic */
+	static constexpr uint32 SolverKernelCount = 1 << 6;
+
+	using FSolverKernel = void (UCollisionAnticipationSpringArm::*)(float DeltaTime, uint32 RuntimeFeatures);
+
 public:
 
 	/** Natural length of the spring arm when there are no collisions */
@@ -39,6 +85,19 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera)
 	FVector SocketOffset;
 
+	/**
+	 * Extra views computed from the same arm origin, each one exposed as a socket next to SocketName.
+	 * Their collision traces are shared with the main view and with each other when they go in the same direction.
+	 * Views without a socket name, using SocketName or a name already used by a view above them are ignored.
+	 * The arm only computes the transforms: attach whatever renders the view to its socket, for example a scene capture for a picture in picture or a rear view mirror.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera)
+	TArray<FCameraArmView> AdditionalViews;
+
+	/** Traces of different views closer than this angle (in degrees) are only done once, the biggest error on the camera position is ArmLength * sin(angle) */
+	UPROPERTY(EditAnywhere, Category = Camera, meta = (ClampMin = "0.0", ClampMax = "5.0", UIMin = "0.0", UIMax = "5.0"))
+	float SharedTraceAngleTolerance = 0.5f;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera, meta = (ClampMin = "50.0", ClampMax = "1000.0", UIMin = "50.0", UIMax = "1000.0"))
 	float MaxZoom = 500.f;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Camera, meta = (ClampMin = "50.0", ClampMax = "1000.0", UIMin = "50.0", UIMax = "1000.0"))
@@ -88,7 +147,7 @@ public:
 	* use a curve to multiply the interpolation speed with,
 	* the position of the curve is determined by the angle between the camera and the closest wall
 	* the smaller the angle between the wall and the camera, the faster the camera can move*/
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = CameraCollision)
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = CameraCollision)
 	uint32 bUseSpeedCurve : 1;
 
 	/**
@@ -96,7 +155,7 @@ public:
 	* for example if we detect a wall 1 meter from us and the camera is usually 4 meters away,
 	* the ideal correction is 3 meters but if the wall is still at a big angle from us we might want to correct less than that
 	* this works better with high trace count because on low count you can see the jumps */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = CameraCollision)
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = CameraCollision)
 	uint32 bUsePositionCurve : 1;
 
 	UPROPERTY(EditAnywhere, Category = CameraCollision)
@@ -105,6 +164,30 @@ public:
 	UPROPERTY(EditAnywhere, Category = CameraCollision)
 	UCurveFloat* PositionCurve;
 
+	/** If true, primitives around the arm that match the filter below are ignored by the collision prediction and the collision test */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "CameraCollision|Filter")
+	uint32 bFilterCameraBlockers : 1;
+
+	/** Primitives with a bounding sphere radius smaller than this (in unreal units) never push the camera */
+	UPROPERTY(EditAnywhere, Category = "CameraCollision|Filter", meta = (editcondition = "bFilterCameraBlockers", ClampMin = "0.0", UIMin = "0.0", UIMax = "200.0"))
+	float MinBlockerSize = 30.f;
+
+	/** Primitives with one of these tags, or owned by an actor with one of these tags, never push the camera */
+	UPROPERTY(EditAnywhere, Category = "CameraCollision|Filter", meta = (editcondition = "bFilterCameraBlockers"))
+	TArray<FName> IgnoredBlockerTags;
+
+	/** Primitives of these object types never push the camera, for example ECC_Pawn to ignore other characters */
+	UPROPERTY(EditAnywhere, Category = "CameraCollision|Filter", meta = (editcondition = "bFilterCameraBlockers"))
+	TArray<TEnumAsByte<ECollisionChannel>> IgnoredBlockerObjectTypes;
+
+	/** How often (in seconds) we look for primitives entering or leaving the arm radius to update the list of ignored primitives */
+	UPROPERTY(EditAnywhere, Category = "CameraCollision|Filter", meta = (editcondition = "bFilterCameraBlockers", ClampMin = "0.0", ClampMax = "2.0", UIMin = "0.0", UIMax = "2.0"))
+	float BlockerFilterRefreshInterval = 0.25f;
+
+	/** If true, the collision prediction only sees static geometry, moving props can still push the camera through the collision test */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "CameraCollision|Filter", meta = (editcondition = "bDoCollisionPrediction"))
+	uint32 bPredictStaticOnly : 1;
+
 	/**
 	 * If this component is placed on a pawn, should it use the view/control rotation of the pawn where possible?
 	 * When disabled, the component will revert to using the stored RelativeRotation of the component.
@@ -130,9 +213,25 @@ public:
 	uint32 bInheritRoll : 1;
 
 	/** If true AND the view target is simulating using physics then use the same max timestep cap as the physics system. Prevents camera jitter when delta time is clamped within Chaos Physics. */
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Lag)
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = Lag)
 	uint32 bClampToMaxPhysicsDeltaTime : 1;
 
+	/** If true, the arm is not recomputed while the camera is settled and nothing it depends on (location, rotation, length, offset) changes */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Optimization)
+	uint32 bSkipSolverWhenIdle : 1;
+
+	/** While idle, how often (in seconds) the arm is still recomputed to react to obstacles moving into the camera */
+	UPROPERTY(EditAnywhere, Category = Optimization, meta = (editcondition = "bSkipSolverWhenIdle", ClampMin = "0.0", ClampMax = "1.0", UIMin = "0.0", UIMax = "1.0"))
+	float IdleRevalidationInterval = 0.2f;
+
+	/**
+	 * If true, the arm stops ticking, tracing and moving its children when nobody can look through it:
+	 * on a dedicated server, on simulated proxies, or when the owning pawn is controlled from another machine.
+	 * Disable this if a spectator or replay camera needs to view through pawns that are not locally controlled.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Network)
+	uint32 bDisableWhenNotViewable : 1;
+
 	UPROPERTY(EditAnywhere, Category = "Debug")
 	bool bPreviewTracesInEditor = true;
 
@@ -140,18 +239,88 @@ public:
 	bool bShowDebugInfo = false;
 
 protected:
-	//small delay when there is no collision prediction before letting the camera come back to it's default position, else we get crazy jitter on small movements
-	float ReturnTimer;
-	float PreviousForwardMovement = 0;
-	FVector PreviousOffset = FVector::ZeroVector;
-	FVector PreviousDesiredLoc = FVector::ZeroVector;
-	/** Cached component-space socket location */
-	FVector RelativeSocketLocation;
-	/** Cached component-space socket rotation */
-	FQuat RelativeSocketRotation;
+	//everything a view remembers from the previous frames
+	struct FArmViewState
+	{
+		//small delay when there is no collision prediction before letting the camera come back to it's default position, else we get crazy jitter on small movements
+		float ReturnTimer = 0;
+		float PreviousForwardMovement = 0;
+		FVector PreviousOffset = FVector::ZeroVector;
+		FVector PreviousDesiredLoc = FVector::ZeroVector;
+		/** Cached component-space socket location */
+		FVector RelativeSocketLocation = FVector::ZeroVector;
+		/** Cached component-space socket rotation */
+		FQuat RelativeSocketRotation = FQuat::Identity;
+	};
+
+	//what a view asks of the solver this frame
+	struct FArmViewRequest
+	{
+		FRotator Rotation;
+		FVector Offset;
+		float ArmLength;
+	};
+
+	//a trace done from the arm origin this frame, reused by the other views that need the same one
+	struct FSharedTrace
+	{
+		FVector Direction;
+		float Length;
+		//negative if nothing was hit
+		float HitDistance;
+		bool bSweep;
+	};
+
+	//the view at SocketName, and the state of every additional view by socket name
+	FArmViewState MainViewState;
+	TMap<FName, FArmViewState> AdditionalViewStates;
+	TArray<FSharedTrace> SharedTraces;
 
 	bool bIsOffset = false;
 
+	//query params shared by all the traces, only rebuilt from scratch when an ignored primitive leaves the arm radius
+	FCollisionQueryParams SweepQueryParams;
+	FCollisionQueryParams PredictionQueryParams;
+	bool bQueryParamsDirty = true;
+
+	//primitives inside the arm radius that matched the filter on the last refresh
+	TSet<TWeakObjectPtr<UPrimitiveComponent>> IgnoredBlockers;
+	float BlockerFilterTimer = 0;
+
+	//what the solver reads from the arm and its owner that can change at runtime, used to know if it has to run again
+	//settings only editable in the editor mark the solver unsettled from PostEditChangeProperty instead
+	struct FSolverInputs
+	{
+		FTransform ComponentTransform;
+		FRotator TargetRotation = FRotator::ZeroRotator;
+		FVector SocketOffset = FVector::ZeroVector;
+		float ArmLength = 0;
+		float SphereTraceSize = 0;
+		TEnumAsByte<ECollisionChannel> TraceChannel = ECC_Camera;
+		uint32 AdditionalViewsHash = 0;
+		bool bIsOffset = false;
+
+		bool Equals(const FSolverInputs& Other) const;
+	};
+
+	//inputs of the last solve, and whether the camera was done moving after it
+	FSolverInputs LastSolverInputs;
+	bool bSolverSettled = false;
+	float IdleRevalidationTimer = 0;
+
+	//the kernel matching the current settings, only looked up again when they change
+	FSolverKernel ActiveSolver = nullptr;
+	uint32 ActiveSolverFeatures = 0;
+	//the features coming from the properties, recomputed only after MarkSolverFeaturesDirty
+	uint32 SettingsSolverFeatures = 0;
+	bool bSolverFeaturesDirty = true;
+
+	//false when the net role / controller of the owner means nobody can see through this camera, the arm is then fully asleep
+	bool bCameraViewable = true;
+
+	//only warn once about misnamed additional views instead of every frame
+	mutable bool bWarnedInvalidView = false;
+
 public:
 	/**
 	 * Get the target rotation we inherit, used as the base target for the boom rotation.
@@ -167,16 +336,47 @@ public:
 	UFUNCTION(BlueprintCallable, Category = SpringArm)
 	void Zoom(float value);
 
+	/**
+	 * Re-evaluates whether the camera can be viewed on this machine from the net mode, net role and controller of the owner,
+	 * and puts the arm to sleep or wakes it up accordingly. Call this when the owning pawn is possessed or unpossessed.
+	 */
+	UFUNCTION(BlueprintCallable, Category = SpringArm)
+	void RefreshViewableState();
+
+	UFUNCTION(BlueprintCallable, Category = SpringArm)
+	void SetUseSpeedCurve(bool bUse);
+
+	UFUNCTION(BlueprintCallable, Category = SpringArm)
+	void SetUsePositionCurve(bool bUse);
+
+	UFUNCTION(BlueprintCallable, Category = SpringArm)
+	void SetClampToMaxPhysicsDeltaTime(bool bClamp);
+
+	/** The solver kernel is only picked again after this, call it after changing the curves, the debug flag or the setters' properties directly from C++ */
+	void MarkSolverFeaturesDirty();
+
+	/** Forgets which primitives are ignored so they are all checked again, call this after changing the filter settings at runtime */
+	UFUNCTION(BlueprintCallable, Category = SpringArm)
+	void InvalidateBlockerFilter();
+
+	/** Returns true if someone on this machine can look through the camera attached to this arm */
+	UFUNCTION(BlueprintCallable, Category = SpringArm)
+	bool IsCameraViewable() const { return bCameraViewable; }
+
 	// UActorComponent interface
 	virtual void BeginPlay() override;
 	virtual void OnRegister() override;
 	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
 	//virtual void PostLoad() override;
 	//virtual void ApplyWorldOffset(const FVector& InOffset, bool bWorldShift) override;
 	// End of UActorComponent interface
 
 	// USceneComponent interface
 	virtual bool HasAnySockets() const override;
+	virtual bool DoesSocketExist(FName InSocketName) const override;
 	virtual FTransform GetSocketTransform(FName InSocketName, ERelativeTransformSpace TransformSpace = RTS_World) const override;
 	virtual void QuerySupportedSockets(TArray<FComponentSocketDescription>& OutSockets) const override;
 	// End of USceneComponent interface
@@ -184,15 +384,70 @@ public:
 	/** The name of the socket at the end of the spring arm (looking back towards the spring arm origin) */
 	static const FName SocketName;
 
+#if !UE_BUILD_SHIPPING
+	/** Times the generic and the specialized solver kernels of every camera arm of the world with stubbed traces and logs the results (console: CameraArm.BenchmarkSolver) */
+	static void RunSolverBenchmark(UWorld* World, int32 Iterations);
+#endif
+
 	/** Returns the desired rotation for the spring arm, before the rotation constraints such as bInheritPitch etc are enforced. */
 	virtual FRotator GetDesiredRotation() const;
 
 protected:
-	/** Updates the desired arm location, calling BlendLocations to do the actual blending if a trace is done */
+	/** Updates the desired arm location, running the solver kernel that matches the current settings */
 	virtual void UpdateDesiredArmLocation(bool bDoCollision, bool bPredictCollisions, float DeltaTime);
 
+	// reads the current solver inputs from the arm and its owner
+	FSolverInputs GatherSolverInputs() const;
+
+	// gathers the settings into a mask of ESolverFeature, collision and prediction are passed separately to UpdateDesiredArmLocation
+	uint32 ComputeSettingsSolverFeatures() const;
+
+	// returns the solver compiled for these features, or the generic one if SF_Generic is set
+	static FSolverKernel GetSolverKernel(uint32 Features);
+
+	// same as GetSolverKernel, with ExtraFeatures compiled into every kernel of the table
+	template<uint32 ExtraFeatures>
+	static FSolverKernel GetSolverKernelWith(uint32 Features);
+
+	// the actual arm solver, every feature not in Features is compiled out unless Features contains SF_Generic
+	template<uint32 Features>
+	void SolveArm(float DeltaTime, uint32 RuntimeFeatures);
+
+	// moves one view out of the walls and updates its socket, returns true if the view is done moving
+	template<uint32 Features>
+	bool SolveView(const FArmViewRequest& View, FArmViewState& State, const FVector& ArmOrigin, const FTransform& ComponentTransform, float DeltaTime, uint32 RuntimeFeatures);
+
 	// do line traces in a horizontal fan shape to check for walls and calculates how much we need the camera to move forward based on the collisions we hit
-	bool CheckSurroundingWallsCollisions(FCollisionPredictionResult& OutResult, const FRotator& cameraRotation, float armLength, float startAngle,  float endAngle, int traceCount);
+	template<uint32 Features>
+	bool CheckSurroundingWallsCollisions(FCollisionPredictionResult& OutResult, const FRotator& cameraRotation, float armLength, float nominalArmLength, float startAngle,  float endAngle, int traceCount, uint32 RuntimeFeatures);
+
+	// line trace or sphere sweep from the arm origin, answered from a trace of another view this frame when one covers it
+	template<uint32 Features>
+	bool TraceFromOrigin(const FVector& ArmOrigin, const FVector& TraceEnd, bool bSweep, float& OutHitDistance);
+
+	// returns the component-space transform of the view at this socket, the main view if no additional view uses it
+	FTransform GetRelativeSocketTransform(FName InSocketName) const;
+
+	// returns the index of the additional view owning this socket, INDEX_NONE if there is none
+	int32 FindViewIndex(FName InSocketName) const;
+
+	// true if the additional view at this index owns its socket name, warns once about the first view that doesn't
+	bool IsValidView(int32 ViewIndex) const;
+
+	// looks for primitives entering or leaving the arm radius and keeps the ignore list of the query params up to date
+	void UpdateBlockerFilter(const FVector& ArmOrigin, float Radius, float DeltaTime);
+
+	// returns false if this primitive matches the filter and should never push the camera
+	bool IsRelevantBlocker(const UPrimitiveComponent* Component) const;
+
+	// rebuilds the query params from the owner and the currently ignored primitives
+	void RebuildQueryParams();
+
+	// computes if the camera can be seen on this machine, without changing any state
+	bool ComputeCameraViewable() const;
+
+	// forgets everything remembered from the previous frames so the arm restarts cleanly
+	void ResetArmState();
 
 #if WITH_EDITOR
 	void ShowPreviewLines();
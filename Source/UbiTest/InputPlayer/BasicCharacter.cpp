@@ -62,6 +62,17 @@ void ABasicCharacter::SetupPlayerInputComponent(UInputComponent* PlayerInputComp
 	}
 }
 
+void ABasicCharacter::NotifyControllerChanged()
+{
+	Super::NotifyControllerChanged();
+
+	//the camera is only worth updating if the new controller is local, let the arm decide
+	if (IsValid(SpringArm))
+	{
+		SpringArm->RefreshViewableState();
+	}
+}
+
 void ABasicCharacter::Move(const FInputActionValue& InputValue)
 {
 	FVector2D InputVector = InputValue.Get<FVector2D>();
@@ -51,6 +51,9 @@ public:
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
+	// Called on the server and the owning client whenever the pawn is possessed or unpossessed
+	virtual void NotifyControllerChanged() override;
+
 protected:
 	void Move(const FInputActionValue& InputValue);
 	void Look(const FInputActionValue& InputValue);